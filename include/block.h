@@ -1,6 +1,8 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include <cstdint>
+#include <ostream>
 #include <string>
 
 // Represents an axis-aligned rectangular prism ("block") in the model.
@@ -24,13 +26,13 @@ public:
   // Absolute end coordinates (exclusive)
   int x_end, y_end, z_end;
 
-  // Single-character tag (equivalent to Python dtype 'U1' element)
-  char tag;
+  // Dense tag index into the model's TagDictionary
+  std::uint16_t tag;
 
   // Construct a block at (x,y,z) of size (w,h,d), with tag.
   // Optional local offsets default to 0.
-  Block(int x, int y, int z, int w, int h, int d, char tag, int x_off = 0,
-        int y_off = 0, int z_off = 0);
+  Block(int x, int y, int z, int w, int h, int d, std::uint16_t tag,
+        int x_off = 0, int y_off = 0, int z_off = 0);
 
   // Adjust dimensions and keep end coordinates consistent
   void set_width(int w);
@@ -39,8 +41,9 @@ public:
 
   // Print in the exact Python format:
   //   x,y,z,width,height,depth,label
-  // (label is looked up by BlockGrowth and passed in here)
-  void print_block(const std::string& label) const;
+  // (label is looked up by BlockModel and passed in here)
+  void print_block(std::ostream& out, const std::string& label) const;
+  void print_block(const std::string& label) const; // to std::cout
 };
 
 #endif // BLOCK_H
\ No newline at end of file
@@ -2,8 +2,8 @@
 #define BLOCK_GROWTH_H
 
 #include "block.h"
-#include <string>
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 // Flattened 3D container: [depth][height][width]
@@ -25,31 +25,73 @@ public:
     }
 };
 
+// Model cells hold dense tag indices (see TagDictionary). One byte is used while
+// every index fits, two bytes for large tag sets.
+using NarrowCell = std::uint8_t;
+using WideCell = std::uint16_t;
+
+// Operation counts from BlockGrowth runs. They depend only on the model and
+// parent block sizes, never on timing or thread count, so tests can pin them.
+// block_growth.cpp only updates them when built with -DBLOCK_GROWTH_COUNTERS
+// (the perf regression test does this); otherwise they stay zero.
+struct GrowthCounters {
+    std::uint64_t parent_blocks = 0;    // run() calls
+    std::uint64_t blocks_emitted = 0;
+    std::uint64_t window_checks = 0;    // window_is_all + window_is_all_uncompressed calls
+    std::uint64_t grow_block_calls = 0;
+    std::uint64_t cells_scanned = 0;    // model/mask cells read by the mode, window, growth and done checks
+    std::uint64_t mode_slots_scanned = 0; // histogram slots read when picking the mode
+
+    GrowthCounters& operator+=(const GrowthCounters& other);
+};
+
+// Whether the linked block_growth.o updates GrowthCounters. A function rather
+// than a constant because the flag is per object file, not per header include.
+bool growth_counters_enabled();
+
 // BlockGrowth encapsulates the "fit & grow" compression logic for a parent block
-// over a sub-volume (model_slices). The tag_table maps single-char tags to labels.
+// over a sub-volume (model_slices). Emitted blocks are appended to 'out' in
+// emission order; label lookup and printing are left to the caller.
+// tag_rank (see TagDictionary::sort_ranks) has one entry per tag, bounding the
+// cell values; mode ties go to the lowest rank, i.e. the first tag in text order.
+// Instantiated for NarrowCell and WideCell in block_growth.cpp.
+template <typename Cell>
 class BlockGrowth {
 public:
-    BlockGrowth(const Flat3D<char>& model_slices, const std::unordered_map<char, std::string>& tag_table);
+    BlockGrowth(const Flat3D<Cell>& model_slices, const std::vector<std::uint16_t>& tag_rank);
+
+    void run(Block parent_block, std::vector<Block>& out);
 
-    void run(Block parent_block);
+    // Totals over every run() on this instance
+    const GrowthCounters& get_counters() const { return counters; }
 
 private:
-    const Flat3D<char>& model;
-    const std::unordered_map<char, std::string>& tag_table;
+    const Flat3D<Cell>& model;
+    const std::vector<std::uint16_t>& rank;
 
-    Block parent_block{0, 0, 0, 0, 0, 0, '\0'};
+    Block parent_block{0, 0, 0, 0, 0, 0, 0};
     int parent_x_end = 0, parent_y_end = 0, parent_z_end = 0;
 
     // Tracks which cells in 'model' have been compressed (0 = false, 1 = true)
     Flat3D<char> compressed;
 
+    // Per-thread histogram for get_mode_of_uncompressed, one slot per tag and
+    // reused across parent blocks. Only the slots listed in 'touched' are
+    // nonzero, so each call scans and resets just the tags present in the
+    // parent block, however large the tag table is.
+    std::vector<int>& freq;
+    std::vector<Cell> touched;
+
+    // Updated from const helpers too, hence mutable
+    mutable GrowthCounters counters;
+
     bool all_compressed() const;
-    char get_mode_of_uncompressed(const Block& blk) const;
+    Cell get_mode_of_uncompressed(const Block& blk);
 
-    Block fit_block(char mode, int width, int height, int depth);
+    Block fit_block(Cell mode, int width, int height, int depth);
     void grow_block(Block& current, Block& best_block);
 
-    bool window_is_all(char val, int z0, int z1, int y0, int y1, int x0, int x1) const;
+    bool window_is_all(Cell val, int z0, int z1, int y0, int y1, int x0, int x1) const;
     bool window_is_all_uncompressed(int z0, int z1, int y0, int y1, int x0, int x1) const;
     void mark_compressed(int z0, int z1, int y0, int y1, int x0, int x1, char v);
 };
@@ -1,51 +1,171 @@
 #ifndef BLOCK_MODEL_H
 #define BLOCK_MODEL_H
 
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <thread>
 #include <vector>
 #include <future>
-#include <mutex>
 #include "block.h"
 #include "block_growth.h"
+#include "model_stats.h"
+#include "slab_pool.h"
+#include "tag_dictionary.h"
+#include "worker_pool.h"
 
-// BlockModel reads the spec, tag table, and 3D model from stdin,
-// batches slices by parent block thickness, and invokes BlockGrowth.
+// Output of one parent-block compression task
+struct ParentBlockResult {
+    std::vector<Block> blocks;
+    GrowthCounters counters;
+};
+
+// Receives each output block and its label, in output order, on the calling thread
+using BlockSink = std::function<void(const Block& block, const std::string& label)>;
+
+// BlockModel reads the spec, tag table, and 3D model from an input stream (stdin
+// by default), batches slices by parent block thickness, and invokes BlockGrowth.
+// Library callers can skip the text format entirely: set_specification() and
+// set_tag_table() replace the readers, compress() takes a model already in
+// memory, and set_block_sink() receives the blocks instead of std::cout.
 class BlockModel {
 public:
-    BlockModel(); // Constructor to initialize threading
+    explicit BlockModel(std::istream& in = std::cin); // Constructor to initialize threading
     void read_specification(); // reads: x_count, y_count, z_count, parent_x, parent_y, parent_z
-    void read_tag_table();     // reads "tag, label" lines until an empty line
-    void read_model();         // reads z_count slices, each: y_count rows of x_count chars (then blank line)
+    void read_tag_table();     // reads "tag, label" lines until an empty line; all tags share one width
+    void read_model();         // reads z_count slices, each: y_count rows of x_count tags (then blank line)
+    ModelStats analyze_model(); // reads the model like read_model() but only gathers statistics
     void set_num_threads(unsigned int threads); // Set number of threads to use
+    void set_num_slabs(int slabs);              // Set number of slab buffers (default 2, double-buffered)
+
+    // In-memory equivalents of read_specification() and read_tag_table()
+    void set_specification(int x_count, int y_count, int z_count, int parent_x, int parent_y, int parent_z);
+    void set_tag_table(const std::vector<std::pair<std::string, std::string>>& table);
+
+    // Compresses a [z_count][y_count][x_count] model already in memory. Cells are
+    // one-char tags (one-char tag tables only) or tag indices from tag_index().
+    void compress(const Flat3D<char>& model);
+    void compress(const Flat3D<WideCell>& model);
+
+    // Dense index of a tag in the tag table, or -1 if it is not there
+    int tag_index(const std::string& tag) const { return tag_table.find(tag); }
+    const std::string& tag_label(std::uint16_t index) const { return tag_table.label(index); }
+
+    // Where blocks go; the default prints "x,y,z,width,height,depth,label" lines to std::cout
+    void set_block_sink(BlockSink sink);
+
+    // BlockGrowth operation counts summed over the last read_model() or compress().
+    // All zero unless growth_counters_enabled(), i.e. block_growth.cpp was built
+    // with -DBLOCK_GROWTH_COUNTERS; normal builds leave them out for speed.
+    const GrowthCounters& get_growth_counters() const { return growth_counters; }
+
+    // Bytes per model cell (1 or 2) the last read_model(), analyze_model() or
+    // compress() finished with; see TagDictionary::needs_wide_cells()
+    int get_cell_bytes() const { return cell_bytes; }
 
 private:
     int x_count = 0, y_count = 0, z_count = 0;
     int parent_x = 0, parent_y = 0, parent_z = 0;
 
-    // Ring buffer for slices: [parent_z][y_count][x_count]
-    Flat3D<char> model;
+    // Number of slab buffers, each [parent_z][y_count][x_count]. The reader fills
+    // one slab while compression tasks still own earlier ones.
+    int num_slabs = 2;
+
+    // Tag text <-> dense cell index, plus labels
+    TagDictionary tag_table;
+
+    // Text input for the read_* functions, and where output blocks go
+    std::istream* input;
+    std::string line_buffer;
+    BlockSink block_sink;
 
-    // Single-char tag -> label
-    std::unordered_map<char, std::string> tag_table;
+    // A text row that did not fit one-byte cells, as tag indices, kept so the
+    // two-byte pass can store it without reading it again
+    std::vector<std::uint16_t> row_indices;
+    bool replay_row = false;
+
+    int cell_bytes = 1;
+
+    // Where fill_slabs stopped on a tag index too large for its cells. 'carry'
+    // holds the open slab's cells, widened; rows before (z, y) are valid.
+    struct SlabResume {
+        int z = 0, y = 0;
+        Flat3D<WideCell> carry;
+    };
 
     // Threading support
-    mutable std::mutex output_mutex;
     unsigned int num_threads;
 
+    // TagDictionary::sort_ranks() snapshot shared with queued tasks, rebuilt
+    // when tags first seen in the model are registered
+    std::shared_ptr<const std::vector<std::uint16_t>> tag_ranks;
+
+    // Per-parent-block results in emission order, drained front to back
+    std::deque<std::future<ParentBlockResult>> pending_blocks;
+    GrowthCounters growth_counters;
+
     // Helper functions
     static bool is_empty_line(const std::string& s);
-    static void getline_strict(std::string& out);
+    void getline_strict(std::string& out);
     static std::vector<int> split_csv_ints(const std::string& line);
 
-    static Flat3D<char> slice_model(const Flat3D<char>& src,
-                                    int depth, int y0, int y1, int x0, int x1);
+    void check_model_shape(int depth, int height, int width) const;
+
+    // The Cell-templated members below are instantiated in block_model.cpp for
+    // NarrowCell and WideCell. Runs start with tag_table.needs_wide_cells(); a
+    // one-byte text run that meets a tag index above 255 stops at that row and
+    // the rest of the model, from the open slab on, goes through two-byte cells.
+
+    // Fills one model row (absolute slice z, row y) of x_count cells. Returns
+    // false if a tag index does not fit in Cell.
+    template <typename Cell>
+    using RowSource = std::function<bool(int z, int y, Cell* row)>;
+
+    // Fills the model slab by slab from fill_row, starting at 'resume', and calls
+    // on_slab each time parent_z slices (or the final partial slab) are buffered.
+    // on_slab takes over the filler's reference and must release it. Returns
+    // false, with 'resume' set, if fill_row stopped on a row Cell cannot hold.
+    template <typename Cell>
+    bool fill_slabs(SlabPool<Cell>& pool, const RowSource<Cell>& fill_row,
+                    const std::function<void(Slab<Cell>*)>& on_slab, SlabResume& resume);
+
+    // RowSource for the text format on 'input'
+    template <typename Cell>
+    bool read_row(int z, int y, Cell* row);
+
+    // RowSource for compress(const Flat3D<WideCell>&)
+    template <typename Cell>
+    bool copy_index_row(const Flat3D<WideCell>& src, int z, int y, Cell* row) const;
+
+    template <typename Cell>
+    static Flat3D<Cell> slice_model(const Flat3D<Cell>& src, int depth, int y0, int y1, int x0, int x1);
+
+    void start_compression();
+    template <typename Cell>
+    bool compress_model(const RowSource<Cell>& fill_row, SlabResume& resume);
+    template <typename Cell>
+    void compress_slices(SlabPool<Cell>& pool, Slab<Cell>* slab, WorkerPool& workers);
+    template <typename Cell>
+    static ParentBlockResult process_parent_block(
+        SlabPool<Cell>& pool, Slab<Cell>* slab, const Block& parent_block,
+        const std::vector<std::uint16_t>& tag_rank
+    );
+    void emit_blocks(const std::vector<Block>& blocks) const;
+    void drain_pending(bool wait_all);
 
-    void compress_slices(int top_slice, int n_slices);
-    void process_parent_block(int x, int y, int z, int width, int height, int depth, char tag, int n_slices);
-    std::string process_parent_block_to_string(int x, int y, int z, int width, int height, int depth, char tag, int n_slices);
-    std::string process_parent_block_to_string_safe(const Flat3D<char>& model_slices, const Block& parentBlock);
+    template <typename Cell>
+    bool analyze_cells(std::vector<StatsAccumulator>& workers, SlabResume& resume);
+    template <typename Cell>
+    void analyze_slices(SlabPool<Cell>& pool, Slab<Cell>* slab, std::vector<StatsAccumulator>& workers,
+                        WorkerPool& threads, std::vector<std::future<void>>& running);
+    static void wait_for_analysis(std::vector<std::future<void>>& running);
+    template <typename Cell>
+    void analyze_parent_row(const Slab<Cell>& slab, int y, StatsAccumulator& acc) const;
 };
 
 #endif // BLOCK_MODEL_H
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef MODEL_STATS_H
+#define MODEL_STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Byte histogram that spreads increments over four interleaved count tables so
+// consecutive equal bytes do not serialise on the same counter. Counts are kept
+// in 32-bit lanes and folded into 64-bit totals by flush_into().
+class ByteHistogram {
+public:
+    ByteHistogram() { clear(); }
+
+    void add(const char* data, std::size_t n);
+    void flush_into(std::vector<std::uint64_t>& counts);
+
+private:
+    std::uint32_t lanes[4][256];
+    std::array<std::uint64_t, 256> spill;
+    std::uint64_t pending = 0;
+
+    void clear();
+    void spill_lanes();
+};
+
+// ByteHistogram for two-byte cells: four count lanes per tag, side by side so a
+// tag's lanes share a cache line, sized to the tags registered so far.
+class WideHistogram {
+public:
+    // Grows to 'num_tags' slots; existing counts are kept
+    void resize(std::size_t num_tags);
+
+    void add(const std::uint16_t* data, std::size_t n);
+    void flush_into(std::vector<std::uint64_t>& counts);
+
+private:
+    std::vector<std::uint32_t> lanes;  // [tag][4]
+    std::vector<std::uint64_t> spill;
+    std::uint64_t pending = 0;
+
+    void spill_lanes();
+};
+
+// Model-wide statistics gathered by BlockModel::analyze_model() without running
+// the compression. estimated_blocks is a lower bound on the number of output
+// blocks: each parent block emits at least one block per distinct tag it contains.
+struct ModelStats {
+    int x_count = 0, y_count = 0, z_count = 0;
+    int parent_x = 0, parent_y = 0, parent_z = 0;
+
+    std::uint64_t total_cells = 0;
+    std::uint64_t parent_blocks = 0;
+    std::uint64_t uniform_parent_blocks = 0;
+    std::uint64_t estimated_blocks = 0;
+
+    // Cell count per dense tag index
+    std::vector<std::uint64_t> tag_cells;
+
+    // Tag text and label per dense index, used for the report only
+    std::vector<std::string> tags;
+    std::vector<std::string> labels;
+
+    void merge(const ModelStats& other);
+    void write_json(std::ostream& out) const;
+};
+
+// Per-worker scratch for BlockModel::analyze_model(). One-byte cells are counted
+// through 'histogram', two-byte cells through 'wide_histogram'. seen[t] holds the
+// id of the last parent block that contained tag t.
+struct StatsAccumulator {
+    ModelStats stats;
+    ByteHistogram histogram;
+    WideHistogram wide_histogram;
+    std::vector<std::uint32_t> seen;
+    std::uint32_t parent_id = 0;
+};
+
+#endif  // MODEL_STATS_H
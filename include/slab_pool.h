@@ -0,0 +1,45 @@
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include "block_growth.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// One buffered slab: up to parent_z slices of the model, [parent_z][y_count][x_count].
+// top_slice is the absolute z of cells.at(0, ..., ...); n_slices is how many are valid.
+template <typename Cell>
+struct Slab {
+    Flat3D<Cell> cells;
+    int top_slice = 0;
+    int n_slices = 0;
+    std::atomic<int> refs{0};
+};
+
+// Fixed pool of slab buffers with explicit ownership. The reader acquires a free
+// slab, fills it and hands references to compression tasks; each owner releases
+// its reference when done, and the slab returns to the pool once the count drops
+// to zero, regardless of the order in which the owners finish.
+// Instantiated for NarrowCell and WideCell in slab_pool.cpp.
+template <typename Cell>
+class SlabPool {
+public:
+    SlabPool(int n_buffers, int depth, int height, int width);
+
+    // Blocks until a buffer is free; the caller holds the only reference
+    Slab<Cell>* acquire();
+    void retain(Slab<Cell>* slab);
+    void release(Slab<Cell>* slab);
+
+    int size() const { return static_cast<int>(slabs.size()); }
+
+private:
+    std::vector<std::unique_ptr<Slab<Cell>>> slabs;
+    std::vector<Slab<Cell>*> free_slabs;
+    std::mutex mutex;
+    std::condition_variable available;
+};
+
+#endif  // SLAB_POOL_H
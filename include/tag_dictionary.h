@@ -0,0 +1,72 @@
+#ifndef TAG_DICTIONARY_H
+#define TAG_DICTIONARY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Maps tag text to a dense index (0..size()-1) and back to its label. Model cells
+// store the index, so histograms only need size() entries and the cell type can
+// be one byte whenever every index fits.
+//
+// All tags share one width (chars per cell in a model row). Width 1 is the
+// classic one-char-per-cell format. Tags from the tag table are numbered in
+// sorted order; tags first seen in the model are appended and use their own
+// text as label, so indices alone are not in text order. BlockGrowth breaks
+// mode ties with sort_ranks() instead, which matches the old raw-byte order.
+class TagDictionary {
+public:
+    static constexpr std::size_t MAX_TAGS = 65536;
+
+    TagDictionary() { clear(); }
+
+    // 'index' views the strings in 'tags', so a copy rebuilds it over its own
+    // deque. Moves keep the deque's elements in place and need no fix-up.
+    TagDictionary(const TagDictionary& other);
+    TagDictionary& operator=(const TagDictionary& other);
+    TagDictionary(TagDictionary&&) = default;
+    TagDictionary& operator=(TagDictionary&&) = default;
+
+    void clear();
+
+    // Registers (tag, label) pairs from the tag table; a repeated tag keeps the
+    // last label. Throws on mixed tag widths or more than MAX_TAGS tags.
+    void assign(const std::vector<std::pair<std::string, std::string>>& table);
+
+    // Index for the 'width()' chars at 'token', registering unknown tags
+    std::uint16_t index_of(const char* token);
+
+    // Index of 'tag', or -1 if it is not registered
+    int find(std::string_view tag) const;
+
+    // rank[i] is the position of tag(i) among all registered tags in text order
+    std::vector<std::uint16_t> sort_ranks() const;
+
+    int width() const { return tag_width; }
+    std::size_t size() const { return tags.size(); }
+    const std::string& tag(std::uint16_t index) const { return tags[index]; }
+    const std::string& label(std::uint16_t index) const { return labels[index]; }
+
+    // One-byte cells are enough while no registered index exceeds 255. Width-1
+    // tags never need more; wider tags first seen in the model can still push an
+    // index past 255, and BlockModel switches to two-byte cells at that point.
+    bool needs_wide_cells() const { return tags.size() > 256; }
+
+private:
+    int tag_width = 1;
+    std::deque<std::string> tags;  // deque keeps the views in 'index' valid
+    std::deque<std::string> labels;
+    std::unordered_map<std::string_view, std::uint16_t> index;
+    std::array<std::int32_t, 256> byte_index;  // width-1 fast path, -1 = unseen
+
+    std::uint16_t add(const std::string& tag, const std::string& label);
+    void rebuild_index();
+};
+
+#endif  // TAG_DICTIONARY_H
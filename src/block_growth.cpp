@@ -2,14 +2,50 @@
 #include <stdexcept>
 #include <algorithm>
 
-using std::string;
-using std::unordered_map;
+// Counter updates compile away unless BLOCK_GROWTH_COUNTERS is defined; the
+// window and growth checks run tens of millions of times on large models.
+#ifdef BLOCK_GROWTH_COUNTERS
+#define GROWTH_COUNT(field, n) (counters.field += (n))
+#else
+#define GROWTH_COUNT(field, n) ((void)0)
+#endif
+
+// Cells a row-major scan has visited before reaching (outer, inner), for counters
+static inline std::uint64_t scan_position(std::uint64_t outer, int inner_len, int inner) {
+    return outer * inner_len + inner;
+}
 
-BlockGrowth::BlockGrowth(const Flat3D<char>& model_slices,
-                         const unordered_map<char, string>& tag_table)
-    : model(model_slices), tag_table(tag_table) {}
+bool growth_counters_enabled() {
+#ifdef BLOCK_GROWTH_COUNTERS
+    return true;
+#else
+    return false;
+#endif
+}
+
+GrowthCounters& GrowthCounters::operator+=(const GrowthCounters& other) {
+    parent_blocks += other.parent_blocks;
+    blocks_emitted += other.blocks_emitted;
+    window_checks += other.window_checks;
+    grow_block_calls += other.grow_block_calls;
+    cells_scanned += other.cells_scanned;
+    mode_slots_scanned += other.mode_slots_scanned;
+    return *this;
+}
 
-void BlockGrowth::run(Block parent_block_) {
+// All zero between get_mode_of_uncompressed calls, so it never needs clearing
+static std::vector<int>& freq_scratch(std::size_t num_tags) {
+    thread_local std::vector<int> scratch;
+    if (scratch.size() < num_tags) scratch.resize(num_tags, 0);
+    return scratch;
+}
+
+template <typename Cell>
+BlockGrowth<Cell>::BlockGrowth(const Flat3D<Cell>& model_slices, const std::vector<std::uint16_t>& tag_rank)
+    : model(model_slices), rank(tag_rank), freq(freq_scratch(tag_rank.size())) {}
+
+template <typename Cell>
+void BlockGrowth<Cell>::run(Block parent_block_, std::vector<Block>& out) {
     parent_block = parent_block_;
     parent_x_end = parent_block.x_offset + parent_block.width;
     parent_y_end = parent_block.y_offset + parent_block.height;
@@ -21,49 +57,54 @@ void BlockGrowth::run(Block parent_block_) {
                               parent_block.width,
                               0);
 
+    GROWTH_COUNT(parent_blocks, 1);
     while (!all_compressed()) {
-        char mode = get_mode_of_uncompressed(parent_block);
+        Cell mode = get_mode_of_uncompressed(parent_block);
         int cube_size = std::min({parent_block.width, parent_block.height, parent_block.depth});
-        Block b = fit_block(mode, cube_size, cube_size, cube_size);
-
-        auto it = tag_table.find(b.tag);
-        const string& label = (it == tag_table.end()) ? string(1, b.tag) : it->second;
-        b.print_block(label);
+        out.push_back(fit_block(mode, cube_size, cube_size, cube_size));
+        GROWTH_COUNT(blocks_emitted, 1);
     }
 }
 
-bool BlockGrowth::all_compressed() const {
-    for (char v : compressed.data)
-        if (v == 0) return false;
-    return true;
+template <typename Cell>
+bool BlockGrowth<Cell>::all_compressed() const {
+    auto first_open = std::find(compressed.data.begin(), compressed.data.end(), 0);
+    bool done = first_open == compressed.data.end();
+    GROWTH_COUNT(cells_scanned, (first_open - compressed.data.begin()) + (done ? 0 : 1));
+    return done;
 }
 
-char BlockGrowth::get_mode_of_uncompressed(const Block& blk) const {
+template <typename Cell>
+Cell BlockGrowth<Cell>::get_mode_of_uncompressed(const Block& blk) {
     int z0 = blk.z_offset, z1 = blk.z_offset + blk.depth;
     int y0 = blk.y_offset, y1 = blk.y_offset + blk.height;
     int x0 = blk.x_offset, x1 = blk.x_offset + blk.width;
 
-    int freq[256] = {0};
+    GROWTH_COUNT(cells_scanned, static_cast<std::uint64_t>(blk.depth) * blk.height * blk.width);
     for (int z = z0; z < z1; ++z)
         for (int y = y0; y < y1; ++y)
             for (int x = x0; x < x1; ++x)
                 if (compressed.at(z, y, x) == 0) {
-                    unsigned char uc = static_cast<unsigned char>(model.at(z, y, x));
-                    ++freq[uc];
+                    Cell v = model.at(z, y, x);
+                    if (freq[v]++ == 0) touched.push_back(v);
                 }
 
-    char best = 0;
+    Cell best = 0;
     int bestCount = -1;
-    for (int i = 0; i < 256; ++i) {
-        if (freq[i] > bestCount) {
-            bestCount = freq[i];
-            best = static_cast<char>(i);
+    GROWTH_COUNT(mode_slots_scanned, touched.size());
+    for (Cell v : touched) {
+        if (freq[v] > bestCount || (freq[v] == bestCount && rank[v] < rank[best])) {
+            bestCount = freq[v];
+            best = v;
         }
+        freq[v] = 0;
     }
+    touched.clear();
     return best;
 }
 
-Block BlockGrowth::fit_block(char mode, int width, int height, int depth) {
+template <typename Cell>
+Block BlockGrowth<Cell>::fit_block(Cell mode, int width, int height, int depth) {
     for (int z = parent_block.z; z < parent_block.z_end; ++z) {
         int z_off = z - parent_block.z;
         int z_end = z_off + depth;
@@ -97,31 +138,46 @@ Block BlockGrowth::fit_block(char mode, int width, int height, int depth) {
     return fit_block(mode, width - 1, height - 1, depth - 1);
 }
 
-bool BlockGrowth::window_is_all(char val,
+template <typename Cell>
+bool BlockGrowth<Cell>::window_is_all(Cell val,
                                 int z0, int z1, int y0, int y1, int x0, int x1) const {
+    GROWTH_COUNT(window_checks, 1);
     for (int z = z0; z < z1; ++z)
         for (int y = y0; y < y1; ++y)
             for (int x = x0; x < x1; ++x)
-                if (model.at(z, y, x) != val) return false;
+                if (model.at(z, y, x) != val) {
+                    GROWTH_COUNT(cells_scanned, scan_position(scan_position(z - z0, y1 - y0, y - y0), x1 - x0, x - x0) + 1);
+                    return false;
+                }
+    GROWTH_COUNT(cells_scanned, scan_position(scan_position(z1 - z0, y1 - y0, 0), x1 - x0, 0));
     return true;
 }
 
-bool BlockGrowth::window_is_all_uncompressed(int z0, int z1, int y0, int y1, int x0, int x1) const {
+template <typename Cell>
+bool BlockGrowth<Cell>::window_is_all_uncompressed(int z0, int z1, int y0, int y1, int x0, int x1) const {
+    GROWTH_COUNT(window_checks, 1);
     for (int z = z0; z < z1; ++z)
         for (int y = y0; y < y1; ++y)
             for (int x = x0; x < x1; ++x)
-                if (compressed.at(z, y, x) != 0) return false;
+                if (compressed.at(z, y, x) != 0) {
+                    GROWTH_COUNT(cells_scanned, scan_position(scan_position(z - z0, y1 - y0, y - y0), x1 - x0, x - x0) + 1);
+                    return false;
+                }
+    GROWTH_COUNT(cells_scanned, scan_position(scan_position(z1 - z0, y1 - y0, 0), x1 - x0, 0));
     return true;
 }
 
-void BlockGrowth::mark_compressed(int z0, int z1, int y0, int y1, int x0, int x1, char v) {
+template <typename Cell>
+void BlockGrowth<Cell>::mark_compressed(int z0, int z1, int y0, int y1, int x0, int x1, char v) {
     for (int z = z0; z < z1; ++z)
         for (int y = y0; y < y1; ++y)
             for (int x = x0; x < x1; ++x)
                 compressed.at(z, y, x) = v;
 }
 
-void BlockGrowth::grow_block(Block& current, Block& best_block) {
+template <typename Cell>
+void BlockGrowth<Cell>::grow_block(Block& current, Block& best_block) {
+    GROWTH_COUNT(grow_block_calls, 1);
     Block b = current;
 
     int x = b.x_offset, y = b.y_offset, z = b.z_offset;
@@ -134,8 +190,12 @@ void BlockGrowth::grow_block(Block& current, Block& best_block) {
         bool ok = true;
         for (int zz = z; zz < z_end && ok; ++zz)
             for (int yy = y; yy < y_end && ok; ++yy) {
-                if (model.at(zz, yy, x_end) != b.tag || compressed.at(zz, yy, x_end) != 0) ok = false;
+                if (model.at(zz, yy, x_end) != b.tag || compressed.at(zz, yy, x_end) != 0) {
+                    ok = false;
+                    GROWTH_COUNT(cells_scanned, scan_position(zz - z, y_end - y, yy - y) + 1);
+                }
             }
+        if (ok) GROWTH_COUNT(cells_scanned, scan_position(z_end - z, y_end - y, 0));
         if (ok) { b.set_width(b.width + 1); current = b; grow_block(current, best_block); if (current.volume > best_block.volume) best_block = current; b.set_width(b.width - 1); }
     }
 
@@ -144,8 +204,12 @@ void BlockGrowth::grow_block(Block& current, Block& best_block) {
         bool ok = true;
         for (int zz = z; zz < z_end && ok; ++zz)
             for (int xx = x; xx < x_end && ok; ++xx) {
-                if (model.at(zz, y_end, xx) != b.tag || compressed.at(zz, y_end, xx) != 0) ok = false;
+                if (model.at(zz, y_end, xx) != b.tag || compressed.at(zz, y_end, xx) != 0) {
+                    ok = false;
+                    GROWTH_COUNT(cells_scanned, scan_position(zz - z, x_end - x, xx - x) + 1);
+                }
             }
+        if (ok) GROWTH_COUNT(cells_scanned, scan_position(z_end - z, x_end - x, 0));
         if (ok) { b.set_height(b.height + 1); current = b; grow_block(current, best_block); if (current.volume > best_block.volume) best_block = current; b.set_height(b.height - 1); }
     }
 
@@ -154,11 +218,18 @@ void BlockGrowth::grow_block(Block& current, Block& best_block) {
         bool ok = true;
         for (int yy = y; yy < y_end && ok; ++yy)
             for (int xx = x; xx < x_end && ok; ++xx) {
-                if (model.at(z_end, yy, xx) != b.tag || compressed.at(z_end, yy, xx) != 0) ok = false;
+                if (model.at(z_end, yy, xx) != b.tag || compressed.at(z_end, yy, xx) != 0) {
+                    ok = false;
+                    GROWTH_COUNT(cells_scanned, scan_position(yy - y, x_end - x, xx - x) + 1);
+                }
             }
+        if (ok) GROWTH_COUNT(cells_scanned, scan_position(y_end - y, x_end - x, 0));
         if (ok) { b.set_depth(b.depth + 1); current = b; grow_block(current, best_block); if (current.volume > best_block.volume) best_block = current; b.set_depth(b.depth - 1); }
     }
 
     if (b.volume > best_block.volume)
         best_block = b;
-}
\ No newline at end of file
+}
+
+template class BlockGrowth<NarrowCell>;
+template class BlockGrowth<WideCell>;
@@ -1,15 +1,17 @@
 #include "block_model.h"
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <vector>
 
 using std::string;
-using std::unordered_map;
 using std::vector;
 
-BlockModel::BlockModel() {
+BlockModel::BlockModel(std::istream& in)
+    : input(&in), block_sink([](const Block& b, const string& label) { b.print_block(label); }) {
     // Auto-detect optimal thread count, but cap at 8 for diminishing returns
     num_threads = std::min(std::thread::hardware_concurrency(), 8u);
     if (num_threads == 0) num_threads = 1; // Fallback for systems that don't report
@@ -19,24 +21,39 @@ void BlockModel::set_num_threads(unsigned int threads) {
     num_threads = std::max(1u, threads); // Ensure at least 1 thread
 }
 
+void BlockModel::set_num_slabs(int n) {
+    num_slabs = std::max(1, n); // The reader needs at least one buffer
+}
+
+void BlockModel::set_block_sink(BlockSink sink) {
+    block_sink = std::move(sink);
+}
+
 void BlockModel::read_specification() {
     string line;
     getline_strict(line);
     vector<int> vals = split_csv_ints(line);
     if (vals.size() != 6) throw std::runtime_error("Invalid specification line (need 6 ints).");
-    x_count  = vals[0];
-    y_count  = vals[1];
-    z_count  = vals[2];
-    parent_x = vals[3];
-    parent_y = vals[4];
-    parent_z = vals[5];
+    set_specification(vals[0], vals[1], vals[2], vals[3], vals[4], vals[5]);
+}
+
+void BlockModel::set_specification(int x_count_, int y_count_, int z_count_, int parent_x_, int parent_y_,
+                                   int parent_z_) {
+    if (x_count_ < 0 || y_count_ < 0 || z_count_ < 0 || parent_x_ <= 0 || parent_y_ <= 0 || parent_z_ <= 0)
+        throw std::runtime_error("Invalid specification (negative counts or non-positive parent size).");
+    x_count  = x_count_;
+    y_count  = y_count_;
+    z_count  = z_count_;
+    parent_x = parent_x_;
+    parent_y = parent_y_;
+    parent_z = parent_z_;
 }
 
 void BlockModel::read_tag_table() {
-    tag_table.clear();
+    vector<std::pair<string, string>> entries;
     string line;
     while (true) {
-        if (!std::getline(std::cin, line)) { line.clear(); }
+        if (!std::getline(*input, line)) { line.clear(); }
         if (!line.empty() && line.back() == '\r') line.pop_back();
         if (is_empty_line(line)) break;
 
@@ -44,44 +61,179 @@ void BlockModel::read_tag_table() {
         if (pos == string::npos || pos == 0 || pos + 2 > line.size())
             throw std::runtime_error("Invalid tag table line: " + line);
 
-        char tag = line[0];
-        string label = line.substr(pos + 2);
-        tag_table[tag] = label;
+        entries.emplace_back(line.substr(0, pos), line.substr(pos + 2));
     }
+    set_tag_table(entries);
+}
+
+void BlockModel::set_tag_table(const vector<std::pair<string, string>>& table) {
+    tag_table.assign(table);
 }
 
 void BlockModel::read_model() {
-    model = Flat3D<char>(parent_z, y_count, x_count, '\0');
+    start_compression();
+    SlabResume resume;
+    if (!tag_table.needs_wide_cells() &&
+        compress_model<NarrowCell>([this](int z, int y, NarrowCell* row) { return read_row(z, y, row); }, resume))
+        return;
 
-    int top_slice = 0;
-    int n_slices = parent_z;
+    // Either the table or a tag first seen in the model needs two bytes per cell
+    compress_model<WideCell>([this](int z, int y, WideCell* row) { return read_row(z, y, row); }, resume);
+}
 
-    string line;
-    for (int z = 0; z < z_count; ++z) {
-        for (int y = 0; y < y_count; ++y) {
-            getline_strict(line);
-            if ((int)line.size() < x_count)
-                throw std::runtime_error("Model row shorter than x_count.");
-            for (int x = 0; x < x_count; ++x) {
-                model.at(z % parent_z, y, x) = line[x];
-            }
+void BlockModel::compress(const Flat3D<char>& model) {
+    check_model_shape(model.depth, model.height, model.width);
+    if (tag_table.width() != 1)
+        throw std::runtime_error("Flat3D<char> models need a tag table of one-char tags.");
+
+    // One-char tags never need more than one byte per cell
+    start_compression();
+    SlabResume resume;
+    compress_model<NarrowCell>([&](int z, int y, NarrowCell* row) {
+        const char* src = model.data.data() + (static_cast<std::size_t>(z) * y_count + y) * x_count;
+        for (int x = 0; x < x_count; ++x)
+            row[x] = static_cast<NarrowCell>(tag_table.index_of(src + x));
+        return true;
+    }, resume);
+}
+
+void BlockModel::compress(const Flat3D<WideCell>& model) {
+    check_model_shape(model.depth, model.height, model.width);
+
+    // copy_index_row rejects unregistered indices, so the table size bounds the cells
+    start_compression();
+    SlabResume resume;
+    if (tag_table.needs_wide_cells())
+        compress_model<WideCell>(
+            [&](int z, int y, WideCell* row) { return copy_index_row(model, z, y, row); }, resume);
+    else
+        compress_model<NarrowCell>(
+            [&](int z, int y, NarrowCell* row) { return copy_index_row(model, z, y, row); }, resume);
+}
+
+void BlockModel::check_model_shape(int depth, int height, int width) const {
+    if (depth != z_count || height != y_count || width != x_count)
+        throw std::runtime_error("Model dimensions do not match the specification.");
+}
+
+ModelStats BlockModel::analyze_model() {
+    // One accumulator per worker, merged once the whole model has been read
+    vector<StatsAccumulator> workers(num_threads);
+    replay_row = false;
+    SlabResume resume;
+    if (tag_table.needs_wide_cells() || !analyze_cells<NarrowCell>(workers, resume))
+        analyze_cells<WideCell>(workers, resume);
+
+    ModelStats stats;
+    stats.x_count = x_count;
+    stats.y_count = y_count;
+    stats.z_count = z_count;
+    stats.parent_x = parent_x;
+    stats.parent_y = parent_y;
+    stats.parent_z = parent_z;
+    for (std::size_t t = 0; t < tag_table.size(); ++t) {
+        stats.tags.push_back(tag_table.tag(static_cast<std::uint16_t>(t)));
+        stats.labels.push_back(tag_table.label(static_cast<std::uint16_t>(t)));
+    }
+
+    for (StatsAccumulator& acc : workers) {
+        acc.histogram.flush_into(acc.stats.tag_cells);
+        acc.wide_histogram.flush_into(acc.stats.tag_cells);
+        stats.merge(acc.stats);
+    }
+    return stats;
+}
+
+template <typename Cell>
+bool BlockModel::fill_slabs(SlabPool<Cell>& pool, const RowSource<Cell>& fill_row,
+                            const std::function<void(Slab<Cell>*)>& on_slab, SlabResume& resume) {
+    const int start_z = resume.z, start_y = resume.y;
+    Slab<Cell>* slab = nullptr;
+    if (!resume.carry.data.empty()) {
+        // Rows a one-byte pass already read into the slab it left open
+        slab = pool.acquire();
+        slab->top_slice = start_z - start_z % parent_z;
+        std::copy(resume.carry.data.begin(), resume.carry.data.end(), slab->cells.data.begin());
+        resume.carry = Flat3D<WideCell>();
+    }
+
+    for (int z = start_z; z < z_count; ++z) {
+        if (slab == nullptr) {
+            slab = pool.acquire();
+            slab->top_slice = z;
         }
 
-        if ((z + 1) % parent_z == 0) {
-            compress_slices(top_slice, n_slices);
-            top_slice = z + 1;
+        for (int y = (z == start_z ? start_y : 0); y < y_count; ++y) {
+            if (fill_row(z, y, &slab->cells.at(z % parent_z, y, 0))) continue;
+
+            // Cell is too narrow for this row: leave the open slab to a wider pass
+            resume.z = z;
+            resume.y = y;
+            resume.carry = Flat3D<WideCell>(parent_z, y_count, x_count);
+            std::copy(slab->cells.data.begin(), slab->cells.data.end(), resume.carry.data.begin());
+            pool.release(slab);
+            return false;
         }
 
-        if (z < z_count - 1) {
-            string sep;
-            getline_strict(sep);
+        // Hand over a full slab, or the final partial one
+        if ((z + 1) % parent_z == 0 || z == z_count - 1) {
+            slab->n_slices = z - slab->top_slice + 1;
+            on_slab(slab);
+            slab = nullptr;
+        }
+    }
+    return true;
+}
+
+template <typename Cell>
+bool BlockModel::read_row(int z, int y, Cell* row) {
+    if (replay_row) {
+        // The row a one-byte pass could not store
+        replay_row = false;
+        std::copy(row_indices.begin(), row_indices.end(), row);
+        return true;
+    }
+
+    const int tag_width = tag_table.width();
+    const std::size_t row_length = static_cast<std::size_t>(x_count) * tag_width;
+
+    string& line = line_buffer;
+    getline_strict(line);
+    if (line.size() < row_length)
+        throw std::runtime_error("Model row shorter than x_count.");
+    bool fits = true;
+    for (int x = 0; x < x_count; ++x) {
+        std::uint16_t index = tag_table.index_of(line.data() + static_cast<std::size_t>(x) * tag_width);
+        if (fits && index > std::numeric_limits<Cell>::max()) {
+            // Keep the whole row as indices for the two-byte pass
+            fits = false;
+            row_indices.assign(row, row + x);
         }
+        if (fits)
+            row[x] = static_cast<Cell>(index);
+        else
+            row_indices.push_back(index);
     }
 
-    if (z_count % parent_z != 0) {
-        n_slices = z_count % parent_z;
-        compress_slices(top_slice, n_slices);
+    // Slices are separated by a blank line
+    if (y == y_count - 1 && z < z_count - 1) {
+        string sep;
+        getline_strict(sep);
     }
+
+    replay_row = !fits;
+    return fits;
+}
+
+template <typename Cell>
+bool BlockModel::copy_index_row(const Flat3D<WideCell>& src, int z, int y, Cell* row) const {
+    const WideCell* cells = src.data.data() + (static_cast<std::size_t>(z) * y_count + y) * x_count;
+    for (int x = 0; x < x_count; ++x) {
+        if (cells[x] >= tag_table.size())
+            throw std::runtime_error("Model cell is not a tag index from the tag table.");
+        row[x] = static_cast<Cell>(cells[x]);
+    }
+    return true;
 }
 
 bool BlockModel::is_empty_line(const string& s) {
@@ -91,7 +243,7 @@ bool BlockModel::is_empty_line(const string& s) {
 }
 
 void BlockModel::getline_strict(string& out) {
-    if (!std::getline(std::cin, out)) out.clear();
+    if (!std::getline(*input, out)) out.clear();
     if (!out.empty() && out.back() == '\r') out.pop_back();
 }
 
@@ -110,9 +262,10 @@ vector<int> BlockModel::split_csv_ints(const string& line) {
     return vals;
 }
 
-Flat3D<char> BlockModel::slice_model(const Flat3D<char>& src,
+template <typename Cell>
+Flat3D<Cell> BlockModel::slice_model(const Flat3D<Cell>& src,
                                      int depth, int y0, int y1, int x0, int x1) {
-    Flat3D<char> out(depth, y1 - y0, x1 - x0, '\0');
+    Flat3D<Cell> out(depth, y1 - y0, x1 - x0, 0);
     for (int z = 0; z < depth; ++z)
         for (int y = y0; y < y1; ++y)
             for (int x = x0; x < x1; ++x)
@@ -120,20 +273,195 @@ Flat3D<char> BlockModel::slice_model(const Flat3D<char>& src,
     return out;
 }
 
-void BlockModel::compress_slices(int top_slice, int n_slices) {
+void BlockModel::start_compression() {
+    pending_blocks.clear();
+    growth_counters = GrowthCounters();
+    tag_ranks.reset();
+    replay_row = false;
+}
+
+template <typename Cell>
+bool BlockModel::compress_model(const RowSource<Cell>& fill_row, SlabResume& resume) {
+    cell_bytes = sizeof(Cell);
+
+    // Declared after the slab pool so it is destroyed first: every queued task
+    // has released its slab by the time the pool goes away.
+    SlabPool<Cell> pool(num_slabs, parent_z, y_count, x_count);
+    WorkerPool workers(num_threads);
+
+    bool done = fill_slabs<Cell>(pool, fill_row, [&](Slab<Cell>* slab) {
+        compress_slices(pool, slab, workers);
+        drain_pending(false);
+    }, resume);
+
+    // Everything before the open slab is emitted before a two-byte pass resumes it
+    drain_pending(true);
+    return done;
+}
+
+template <typename Cell>
+void BlockModel::compress_slices(SlabPool<Cell>& pool, Slab<Cell>* slab, WorkerPool& workers) {
+    // Every index in this slab is already registered, so the ranks are final for it
+    if (!tag_ranks || tag_ranks->size() != tag_table.size())
+        tag_ranks = std::make_shared<const vector<std::uint16_t>>(tag_table.sort_ranks());
+    std::shared_ptr<const vector<std::uint16_t>> ranks = tag_ranks;
+
     for (int y = 0; y < y_count; y += parent_y) {
         for (int x = 0; x < x_count; x += parent_x) {
-            int z = top_slice;
+            int z = slab->top_slice;
             int width  = std::min(parent_x, x_count - x);
             int height = std::min(parent_y, y_count - y);
-            int depth  = n_slices;
-            char tag = model.at(z % parent_z, y, x);
+            int depth  = slab->n_slices;
+            Cell tag = slab->cells.at(0, y, x);
 
             Block parentBlock(x, y, z, width, height, depth, tag);
-            Flat3D<char> model_slices = slice_model(model, depth, y, parentBlock.y_end, x, parentBlock.x_end);
 
-            BlockGrowth growth(model_slices, tag_table);
-            growth.run(parentBlock);
+            // Each task owns a reference until it has copied its sub-volume
+            pool.retain(slab);
+            pending_blocks.push_back(workers.submit([&pool, slab, parentBlock, ranks] {
+                return process_parent_block(pool, slab, parentBlock, *ranks);
+            }));
         }
     }
-}
\ No newline at end of file
+
+    // Drop the reader's reference; the slab is recycled once the last task lets go
+    pool.release(slab);
+}
+
+template <typename Cell>
+ParentBlockResult BlockModel::process_parent_block(
+    SlabPool<Cell>& pool, Slab<Cell>* slab, const Block& parent_block,
+    const vector<std::uint16_t>& tag_rank
+) {
+    Flat3D<Cell> model_slices = slice_model(slab->cells, parent_block.depth, parent_block.y,
+                                            parent_block.y_end, parent_block.x, parent_block.x_end);
+    pool.release(slab);
+
+    ParentBlockResult result;
+    BlockGrowth<Cell> growth(model_slices, tag_rank);
+    growth.run(parent_block, result.blocks);
+    result.counters = growth.get_counters();
+    return result;
+}
+
+void BlockModel::emit_blocks(const vector<Block>& blocks) const {
+    for (const Block& b : blocks)
+        block_sink(b, tag_table.label(b.tag));
+}
+
+void BlockModel::drain_pending(bool wait_all) {
+    // Print finished parent blocks in submission order so output stays deterministic
+    while (!pending_blocks.empty()) {
+        auto& front = pending_blocks.front();
+        if (!wait_all && front.wait_for(std::chrono::seconds(0)) != std::future_status::ready) break;
+        ParentBlockResult result = front.get();
+        pending_blocks.pop_front();
+        emit_blocks(result.blocks);
+        growth_counters += result.counters;
+    }
+}
+
+template <typename Cell>
+bool BlockModel::analyze_cells(vector<StatsAccumulator>& workers, SlabResume& resume) {
+    cell_bytes = sizeof(Cell);
+
+    // Two slabs so the next one is read while workers analyze the current one.
+    // Declared after the slab pool so it is destroyed first, as in compress_model.
+    SlabPool<Cell> pool(2, parent_z, y_count, x_count);
+    WorkerPool threads(num_threads);
+    vector<std::future<void>> running;
+
+    RowSource<Cell> fill_row = [this](int z, int y, Cell* row) { return read_row(z, y, row); };
+    bool done = fill_slabs<Cell>(pool, fill_row, [&](Slab<Cell>* slab) {
+        wait_for_analysis(running);
+        analyze_slices(pool, slab, workers, threads, running);
+    }, resume);
+    wait_for_analysis(running);
+    return done;
+}
+
+void BlockModel::wait_for_analysis(vector<std::future<void>>& running) {
+    // get() rethrows anything a worker threw
+    for (auto& f : running)
+        f.get();
+    running.clear();
+}
+
+template <typename Cell>
+void BlockModel::analyze_slices(SlabPool<Cell>& pool, Slab<Cell>* slab, vector<StatsAccumulator>& workers,
+                                WorkerPool& threads, vector<std::future<void>>& running) {
+    // No task is running, so the accumulators can grow for tags first seen in this slab
+    for (StatsAccumulator& acc : workers) {
+        acc.seen.resize(tag_table.size(), 0);
+        if (sizeof(Cell) > 1) acc.wide_histogram.resize(tag_table.size());
+    }
+
+    // Rows of parent blocks are independent, so stripe them across the workers
+    int parent_rows = (y_count + parent_y - 1) / parent_y;
+    unsigned int n_workers = std::min<unsigned int>(num_threads, std::max(parent_rows, 1));
+
+    for (unsigned int t = 0; t < n_workers; ++t) {
+        pool.retain(slab);
+        running.push_back(threads.submit([this, &pool, slab, &acc = workers[t], t, n_workers, parent_rows] {
+            for (int row = t; row < parent_rows; row += n_workers)
+                analyze_parent_row(*slab, row * parent_y, acc);
+            pool.release(slab);
+        }));
+    }
+
+    // Drop the reader's reference; the slab is recycled once the last task lets go
+    pool.release(slab);
+}
+
+template <typename Cell>
+void BlockModel::analyze_parent_row(const Slab<Cell>& slab, int y, StatsAccumulator& acc) const {
+    const Flat3D<Cell>& model = slab.cells;
+    ModelStats& stats = acc.stats;
+    int n_slices = slab.n_slices;
+    int height = std::min(parent_y, y_count - y);
+
+    for (int x = 0; x < x_count; x += parent_x) {
+        int width = std::min(parent_x, x_count - x);
+        std::uint64_t cells = static_cast<std::uint64_t>(width) * height * n_slices;
+
+        // Uniformity check first: a uniform parent needs no histogram pass
+        const Cell first = model.at(0, y, x);
+        bool uniform = true;
+        for (int z = 0; z < n_slices && uniform; ++z)
+            for (int yy = y; yy < y + height && uniform; ++yy) {
+                const Cell* row = &model.at(z, yy, x);
+                bool same = true;
+                for (int i = 0; i < width; ++i)
+                    same &= row[i] == first;
+                uniform = same;
+            }
+
+        ++stats.parent_blocks;
+        stats.total_cells += cells;
+
+        if (uniform) {
+            ++stats.uniform_parent_blocks;
+            ++stats.estimated_blocks;
+            if (stats.tag_cells.size() <= first) stats.tag_cells.resize(first + 1, 0);
+            stats.tag_cells[first] += cells;
+            continue;
+        }
+
+        // Distinct tags: seen[t] == id marks t as already counted for this parent
+        std::uint32_t id = ++acc.parent_id;
+        for (int z = 0; z < n_slices; ++z)
+            for (int yy = y; yy < y + height; ++yy) {
+                const Cell* row = &model.at(z, yy, x);
+                if constexpr (sizeof(Cell) == 1)
+                    acc.histogram.add(reinterpret_cast<const char*>(row), width);
+                else
+                    acc.wide_histogram.add(row, width);
+                for (int i = 0; i < width; ++i) {
+                    if (acc.seen[row[i]] != id) {
+                        acc.seen[row[i]] = id;
+                        ++stats.estimated_blocks;
+                    }
+                }
+            }
+    }
+}
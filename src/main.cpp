@@ -1,14 +1,26 @@
 #include "block_model.h"
+#include <cstring>
 #include <iostream>
 
-int main() {
+int main(int argc, char* argv[]) {
   std::ios::sync_with_stdio(false);
   std::cin.tie(nullptr);
 
+  // --analyze: report model statistics as JSON instead of compressing
+  bool analyze = argc == 2 && std::strcmp(argv[1], "--analyze") == 0;
+  if (argc > 1 && !analyze) {
+    std::cerr << "Usage: " << argv[0] << " [--analyze] < model.txt\n";
+    return 1;
+  }
+
   BlockModel bm;
   bm.read_specification();
   bm.read_tag_table();
-  bm.read_model();
+  if (analyze) {
+    bm.analyze_model().write_json(std::cout);
+  } else {
+    bm.read_model();
+  }
   return 0;
 } // Test comment
 // Test comment for pre-commit hook
@@ -0,0 +1,157 @@
+#include "model_stats.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+// Fold the 32-bit lanes into the 64-bit totals well before they can overflow
+static constexpr std::uint64_t FLUSH_THRESHOLD = 1ull << 30;
+
+void ByteHistogram::clear() {
+    std::memset(lanes, 0, sizeof(lanes));
+    spill.fill(0);
+    pending = 0;
+}
+
+void ByteHistogram::add(const char* data, std::size_t n) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    std::size_t i = 0;
+
+    // Eight bytes per iteration, two per lane
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        ++lanes[0][w & 0xFF];
+        ++lanes[1][(w >> 8) & 0xFF];
+        ++lanes[2][(w >> 16) & 0xFF];
+        ++lanes[3][(w >> 24) & 0xFF];
+        ++lanes[0][(w >> 32) & 0xFF];
+        ++lanes[1][(w >> 40) & 0xFF];
+        ++lanes[2][(w >> 48) & 0xFF];
+        ++lanes[3][w >> 56];
+    }
+    for (; i < n; ++i)
+        ++lanes[i & 3][p[i]];
+
+    pending += n;
+    if (pending >= FLUSH_THRESHOLD) spill_lanes();
+}
+
+void ByteHistogram::spill_lanes() {
+    for (int b = 0; b < 256; ++b)
+        spill[b] += static_cast<std::uint64_t>(lanes[0][b]) + lanes[1][b] + lanes[2][b] + lanes[3][b];
+    std::memset(lanes, 0, sizeof(lanes));
+    pending = 0;
+}
+
+void ByteHistogram::flush_into(std::vector<std::uint64_t>& counts) {
+    spill_lanes();
+    for (std::size_t b = 0; b < 256; ++b) {
+        if (spill[b] == 0) continue;
+        if (b >= counts.size()) counts.resize(b + 1, 0);
+        counts[b] += spill[b];
+    }
+    clear();
+}
+
+void WideHistogram::resize(std::size_t num_tags) {
+    if (spill.size() >= num_tags) return;
+    lanes.resize(num_tags * 4, 0);
+    spill.resize(num_tags, 0);
+}
+
+void WideHistogram::add(const std::uint16_t* data, std::size_t n) {
+    std::uint32_t* counts = lanes.data();
+    std::size_t i = 0;
+
+    // Four cells per iteration, one per lane
+    for (; i + 4 <= n; i += 4) {
+        ++counts[data[i] * 4];
+        ++counts[data[i + 1] * 4 + 1];
+        ++counts[data[i + 2] * 4 + 2];
+        ++counts[data[i + 3] * 4 + 3];
+    }
+    for (; i < n; ++i)
+        ++counts[data[i] * 4 + (i & 3)];
+
+    pending += n;
+    if (pending >= FLUSH_THRESHOLD) spill_lanes();
+}
+
+void WideHistogram::spill_lanes() {
+    for (std::size_t t = 0; t < spill.size(); ++t) {
+        const std::uint32_t* c = &lanes[t * 4];
+        spill[t] += static_cast<std::uint64_t>(c[0]) + c[1] + c[2] + c[3];
+    }
+    std::fill(lanes.begin(), lanes.end(), 0);
+    pending = 0;
+}
+
+void WideHistogram::flush_into(std::vector<std::uint64_t>& counts) {
+    spill_lanes();
+    if (counts.size() < spill.size()) counts.resize(spill.size(), 0);
+    for (std::size_t t = 0; t < spill.size(); ++t)
+        counts[t] += spill[t];
+    std::fill(spill.begin(), spill.end(), 0);
+}
+
+void ModelStats::merge(const ModelStats& other) {
+    total_cells += other.total_cells;
+    parent_blocks += other.parent_blocks;
+    uniform_parent_blocks += other.uniform_parent_blocks;
+    estimated_blocks += other.estimated_blocks;
+    if (tag_cells.size() < other.tag_cells.size()) tag_cells.resize(other.tag_cells.size(), 0);
+    for (std::size_t t = 0; t < other.tag_cells.size(); ++t)
+        tag_cells[t] += other.tag_cells[t];
+}
+
+static void write_json_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        unsigned char uc = static_cast<unsigned char>(c);
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (uc < 0x20) {
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(uc)
+                        << std::dec << std::setfill(' ');
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+void ModelStats::write_json(std::ostream& out) const {
+    double uniform_share = parent_blocks == 0 ? 0.0 : static_cast<double>(uniform_parent_blocks) / parent_blocks;
+
+    out << "{\n";
+    out << "  \"spec\": {\"x_count\": " << x_count << ", \"y_count\": " << y_count << ", \"z_count\": " << z_count
+        << ", \"parent_x\": " << parent_x << ", \"parent_y\": " << parent_y << ", \"parent_z\": " << parent_z
+        << "},\n";
+    out << "  \"total_cells\": " << total_cells << ",\n";
+    out << "  \"parent_blocks\": " << parent_blocks << ",\n";
+    out << "  \"uniform_parent_blocks\": " << uniform_parent_blocks << ",\n";
+    out << "  \"uniform_parent_share\": " << std::fixed << std::setprecision(6) << uniform_share
+        << std::defaultfloat << ",\n";
+    out << "  \"estimated_blocks\": " << estimated_blocks << ",\n";
+    out << "  \"tags\": [";
+
+    bool first = true;
+    for (std::size_t t = 0; t < tags.size(); ++t) {
+        std::uint64_t cells = t < tag_cells.size() ? tag_cells[t] : 0;
+
+        out << (first ? "\n" : ",\n") << "    {\"tag\": ";
+        write_json_string(out, tags[t]);
+        out << ", \"label\": ";
+        write_json_string(out, labels[t]);
+        out << ", \"cells\": " << cells << "}";
+        first = false;
+    }
+    out << (first ? "]\n" : "\n  ]\n");
+    out << "}\n";
+}
@@ -0,0 +1,46 @@
+#include "slab_pool.h"
+#include <stdexcept>
+
+template <typename Cell>
+SlabPool<Cell>::SlabPool(int n_buffers, int depth, int height, int width) {
+    if (n_buffers < 1) throw std::invalid_argument("SlabPool needs at least one buffer.");
+
+    slabs.reserve(n_buffers);
+    free_slabs.reserve(n_buffers);
+    for (int i = 0; i < n_buffers; ++i) {
+        slabs.push_back(std::make_unique<Slab<Cell>>());
+        slabs.back()->cells = Flat3D<Cell>(depth, height, width, 0);
+        free_slabs.push_back(slabs.back().get());
+    }
+}
+
+template <typename Cell>
+Slab<Cell>* SlabPool<Cell>::acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this] { return !free_slabs.empty(); });
+
+    Slab<Cell>* slab = free_slabs.back();
+    free_slabs.pop_back();
+    slab->refs.store(1, std::memory_order_relaxed);
+    return slab;
+}
+
+template <typename Cell>
+void SlabPool<Cell>::retain(Slab<Cell>* slab) {
+    slab->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Cell>
+void SlabPool<Cell>::release(Slab<Cell>* slab) {
+    // acq_rel so every owner's reads of the cells happen before the next reuse
+    if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_slabs.push_back(slab);
+    }
+    available.notify_one();
+}
+
+template class SlabPool<NarrowCell>;
+template class SlabPool<WideCell>;
@@ -0,0 +1,91 @@
+#include "tag_dictionary.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+TagDictionary::TagDictionary(const TagDictionary& other)
+    : tag_width(other.tag_width), tags(other.tags), labels(other.labels), byte_index(other.byte_index) {
+    rebuild_index();
+}
+
+TagDictionary& TagDictionary::operator=(const TagDictionary& other) {
+    if (this == &other) return *this;
+    tag_width = other.tag_width;
+    tags = other.tags;
+    labels = other.labels;
+    byte_index = other.byte_index;
+    rebuild_index();
+    return *this;
+}
+
+void TagDictionary::rebuild_index() {
+    index.clear();
+    index.reserve(tags.size());
+    for (std::size_t i = 0; i < tags.size(); ++i)
+        index.emplace(std::string_view(tags[i]), static_cast<std::uint16_t>(i));
+}
+
+void TagDictionary::clear() {
+    tag_width = 1;
+    tags.clear();
+    labels.clear();
+    index.clear();
+    byte_index.fill(-1);
+}
+
+void TagDictionary::assign(const std::vector<std::pair<std::string, std::string>>& table) {
+    clear();
+
+    // std::map gives sorted tags and last-label-wins in one pass
+    std::map<std::string, std::string> sorted;
+    for (const auto& entry : table)
+        sorted[entry.first] = entry.second;
+
+    if (!sorted.empty()) tag_width = static_cast<int>(sorted.begin()->first.size());
+    for (const auto& entry : sorted) {
+        if (static_cast<int>(entry.first.size()) != tag_width)
+            throw std::runtime_error("All tags must have the same width: " + entry.first);
+        add(entry.first, entry.second);
+    }
+}
+
+std::uint16_t TagDictionary::index_of(const char* token) {
+    if (tag_width == 1) {
+        std::int32_t i = byte_index[static_cast<unsigned char>(*token)];
+        if (i >= 0) return static_cast<std::uint16_t>(i);
+    } else {
+        auto it = index.find(std::string_view(token, tag_width));
+        if (it != index.end()) return it->second;
+    }
+
+    std::string tag(token, tag_width);
+    return add(tag, tag);
+}
+
+int TagDictionary::find(std::string_view tag) const {
+    auto it = index.find(tag);
+    return it == index.end() ? -1 : it->second;
+}
+
+std::vector<std::uint16_t> TagDictionary::sort_ranks() const {
+    std::vector<std::uint16_t> order(tags.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+        order[i] = static_cast<std::uint16_t>(i);
+    std::sort(order.begin(), order.end(), [this](std::uint16_t a, std::uint16_t b) { return tags[a] < tags[b]; });
+
+    std::vector<std::uint16_t> rank(tags.size());
+    for (std::size_t r = 0; r < order.size(); ++r)
+        rank[order[r]] = static_cast<std::uint16_t>(r);
+    return rank;
+}
+
+std::uint16_t TagDictionary::add(const std::string& tag, const std::string& label) {
+    if (tags.size() >= MAX_TAGS) throw std::runtime_error("Too many distinct tags (limit 65536).");
+
+    std::uint16_t i = static_cast<std::uint16_t>(tags.size());
+    tags.push_back(tag);
+    labels.push_back(label);
+    index.emplace(std::string_view(tags.back()), i);
+    if (tag_width == 1) byte_index[static_cast<unsigned char>(tag[0])] = i;
+    return i;
+}
@@ -1,8 +1,13 @@
 #include "block_model.h"
+#include "slab_pool.h"
+#include "test_models.h"
 #include <cassert>
+#include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -15,6 +20,13 @@ public:
     test_basic_compression();
     test_case1_compression();
     test_case2_compression();
+    test_case1_analysis();
+    test_slab_pool_ownership();
+    test_wide_tag_compression();
+    test_unknown_tag_ties();
+    test_unknown_wide_tags();
+    test_tag_dictionary_copy();
+    test_in_memory_compression();
 
     std::cout << "All compression tests passed!\n";
   }
@@ -126,6 +138,334 @@ private:
     std::cin.rdbuf(orig);
     case2_file.close();
   }
+
+  static void test_case1_analysis() {
+    std::cout << "Testing case1 analysis...\n";
+
+    std::ifstream case1_file("tests/data/case1.txt");
+    if (!case1_file.is_open()) {
+      throw std::runtime_error("Could not open tests/data/case1.txt");
+    }
+
+    BlockModel bm(case1_file);
+    bm.read_specification();
+    bm.read_tag_table();
+    ModelStats stats = bm.analyze_model();
+
+    // Tags are numbered in sorted order: e n o q s t v w
+    const size_t sea = 2, tas = 5;
+    if (stats.tags.size() != 8 || stats.tags[sea] != "o" || stats.tags[tas] != "t") {
+      throw std::runtime_error("Case1 analysis tag numbering mismatch");
+    }
+
+    // Expected values counted independently from tests/data/case1.txt
+    if (stats.total_cells != 2560 || stats.parent_blocks != 64 ||
+        stats.uniform_parent_blocks != 58 || stats.estimated_blocks != 70 ||
+        stats.tag_cells[sea] != 2475 || stats.tag_cells[tas] != 85) {
+      throw std::runtime_error("Case1 analysis statistics mismatch");
+    }
+
+    std::cout << "✓ Case1 analysis test passed - " << stats.uniform_parent_blocks
+              << "/" << stats.parent_blocks << " uniform parent blocks\n";
+  }
+
+  static void test_slab_pool_ownership() {
+    std::cout << "Testing slab pool ownership...\n";
+
+    SlabPool<NarrowCell> pool(2, 4, 3, 5);
+    Slab<NarrowCell>* first = pool.acquire();
+    Slab<NarrowCell>* second = pool.acquire();
+
+    // Two tasks own the first slab; they finish in reverse order
+    pool.retain(first);
+    pool.retain(first);
+    pool.release(first); // reader
+    pool.release(first); // second task
+    if (first->refs.load() != 1) {
+      throw std::runtime_error("Slab released before its last owner");
+    }
+    pool.release(first); // first task
+
+    // The only free buffer now is the first slab
+    Slab<NarrowCell>* again = pool.acquire();
+    if (again != first || again->refs.load() != 1) {
+      throw std::runtime_error("Released slab was not returned to the pool");
+    }
+    pool.release(again);
+    pool.release(second);
+
+    std::cout << "✓ Slab pool ownership test passed\n";
+  }
+
+  static void test_wide_tag_compression() {
+    std::cout << "Testing wide tag compression...\n";
+
+    // 300 three-char tags: too many for one-byte cells
+    std::istringstream in(TestModels::wide_tag_model());
+    int cell_bytes = 0;
+    std::string output = compress_stream(in, &cell_bytes);
+    if (cell_bytes != 2) {
+      throw std::runtime_error("300-tag table did not use two-byte cells");
+    }
+
+    check_tiling(output, TestModels::WIDE_X, TestModels::WIDE_Y,
+                 TestModels::WIDE_Z, [](int x, int y, int z) {
+                   return "L" + std::to_string(TestModels::wide_tag_code(x, y, z));
+                 });
+
+    std::cout << "✓ Wide tag compression test passed\n";
+  }
+
+  // Every cell must be covered exactly once by a block with its own label
+  static void check_tiling(const std::string& output, int X, int Y, int Z,
+                           const std::function<std::string(int, int, int)>& label_at) {
+    std::vector<int> covered(X * Y * Z, 0);
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line)) {
+      int x, y, z, w, h, d;
+      char label[16];
+      if (std::sscanf(line.c_str(), "%d,%d,%d,%d,%d,%d,%15s", &x, &y, &z, &w,
+                      &h, &d, label) != 7) {
+        throw std::runtime_error("Malformed block line: " + line);
+      }
+      for (int zz = z; zz < z + d; ++zz)
+        for (int yy = y; yy < y + h; ++yy)
+          for (int xx = x; xx < x + w; ++xx) {
+            if (label_at(xx, yy, zz) != label) {
+              throw std::runtime_error("Wrong label in block: " + line);
+            }
+            ++covered[(zz * Y + yy) * X + xx];
+          }
+    }
+    for (int c : covered) {
+      if (c != 1) {
+        throw std::runtime_error("Blocks do not tile the model");
+      }
+    }
+  }
+
+  static void test_unknown_wide_tags() {
+    std::cout << "Testing multi-char tags missing from the table...\n";
+
+    // A full one-byte table of 256 tags. From slice 3, halfway through the
+    // second slab, the model adds 44 tags of its own, so compression has to
+    // move to two-byte cells after the first slab went out on one byte.
+    const int X = 20, Y = 15, Z = 5, TABLE_TAGS = 256;
+    auto code_at = [](int x, int y, int z) {
+      return z < 3 ? (x + 20 * y) % TABLE_TAGS : (x + 20 * y + z) % 300;
+    };
+    auto label_at = [&](int x, int y, int z) {
+      int code = code_at(x, y, z);
+      return code < TABLE_TAGS ? "L" + std::to_string(code)
+                               : TestModels::padded_tag(code, 3);
+    };
+    std::string model = TestModels::make_model(
+        X, Y, Z, 4, 4, 2, TestModels::numbered_tag_table(TABLE_TAGS, 3),
+        [&](int x, int y, int z) {
+          return TestModels::padded_tag(code_at(x, y, z), 3);
+        });
+
+    std::istringstream in(model);
+    int cell_bytes = 0;
+    check_tiling(compress_stream(in, &cell_bytes), X, Y, Z, label_at);
+    if (cell_bytes != 2) {
+      throw std::runtime_error("Overflowing tag set did not switch to two bytes");
+    }
+
+    // Analysis switches the same way and still counts every cell
+    std::istringstream analyze_in(model);
+    BlockModel bm(analyze_in);
+    bm.read_specification();
+    bm.read_tag_table();
+    ModelStats stats = bm.analyze_model();
+    std::vector<std::uint64_t> expected(300, 0);
+    for (int z = 0; z < Z; ++z)
+      for (int y = 0; y < Y; ++y)
+        for (int x = 0; x < X; ++x)
+          ++expected[code_at(x, y, z)];
+    for (int code = 0; code < 300; ++code) {
+      int index = bm.tag_index(TestModels::padded_tag(code, 3));
+      std::uint64_t counted =
+          index >= 0 && static_cast<std::size_t>(index) < stats.tag_cells.size()
+              ? stats.tag_cells[index]
+              : 0;
+      if (counted != expected[code]) {
+        throw std::runtime_error("Wrong analysis count after the switch");
+      }
+    }
+
+    // A small multi-char table, model-only tags included, keeps one byte
+    std::istringstream small_in(TestModels::make_model(
+        X, Y, 2, 4, 4, 2, TestModels::numbered_tag_table(5, 3),
+        [](int x, int y, int) { return TestModels::padded_tag(x / 2 + y, 3); }));
+    check_tiling(compress_stream(small_in, &cell_bytes), X, Y, 2,
+                 [](int x, int y, int) {
+                   int code = x / 2 + y;
+                   return code < 5 ? "L" + std::to_string(code)
+                                   : TestModels::padded_tag(code, 3);
+                 });
+    if (cell_bytes != 1) {
+      throw std::runtime_error("Small multi-char tag set left one-byte cells");
+    }
+
+    std::cout << "✓ Unknown wide tag test passed\n";
+  }
+
+  static void test_unknown_tag_ties() {
+    std::cout << "Testing mode ties with tags missing from the table...\n";
+
+    // 'a' is not in the table, so it gets the index after 'b', but a tie
+    // between them must still go to 'a', the lower tag in text order
+    std::istringstream one_char("2,1,1,2,1,1\nb, B\n\nba\n\n");
+    std::string result = compress_stream(one_char);
+    if (result != "1,0,0,1,1,1,a\n0,0,0,1,1,1,B\n") {
+      throw std::runtime_error("Unknown one-char tag lost a mode tie: " + result);
+    }
+
+    std::istringstream multi_char("2,1,1,2,1,1\nbb, B\n\nbbaa\n\n");
+    result = compress_stream(multi_char);
+    if (result != "1,0,0,1,1,1,aa\n0,0,0,1,1,1,B\n") {
+      throw std::runtime_error("Unknown multi-char tag lost a mode tie: " + result);
+    }
+
+    std::cout << "✓ Unknown tag tie test passed\n";
+  }
+
+  static void test_tag_dictionary_copy() {
+    std::cout << "Testing tag dictionary copies...\n";
+
+    // The copy must not look tags up through the original's strings
+    TagDictionary copy;
+    {
+      TagDictionary original;
+      original.assign({{"granite", "G"}, {"diorite", "D"}});
+      original.index_of("basalts");
+      copy = original;
+    }
+    TagDictionary copy2(copy);
+    if (copy.find("granite") != 1 || copy.find("basalts") != 2 ||
+        copy2.find("diorite") != 0 || copy2.label(copy2.find("granite")) != "G") {
+      throw std::runtime_error("TagDictionary copy lost its index");
+    }
+
+    std::cout << "✓ Tag dictionary copy test passed\n";
+  }
+
+  // Runs the text path over 'in', collecting blocks through a sink;
+  // cell_bytes, if given, receives the cell width the run finished with
+  static std::string compress_stream(std::istream& in,
+                                     int* cell_bytes = nullptr) {
+    std::ostringstream output;
+    BlockModel bm(in);
+    bm.set_block_sink([&](const Block& b, const std::string& label) {
+      b.print_block(output, label);
+    });
+    bm.read_specification();
+    bm.read_tag_table();
+    bm.read_model();
+    if (cell_bytes) {
+      *cell_bytes = bm.get_cell_bytes();
+    }
+    return output.str();
+  }
+
+  static void test_in_memory_compression() {
+    std::cout << "Testing in-memory compression...\n";
+
+    std::ifstream case1_file("tests/data/case1.txt");
+    if (!case1_file.is_open()) {
+      throw std::runtime_error("Could not open tests/data/case1.txt");
+    }
+    std::string expected = compress_stream(case1_file);
+
+    // Parse case1 by hand into the in-memory form
+    std::ifstream in("tests/data/case1.txt");
+    std::string line;
+    int X, Y, Z, PX, PY, PZ;
+    std::getline(in, line);
+    if (std::sscanf(line.c_str(), "%d,%d,%d,%d,%d,%d", &X, &Y, &Z, &PX, &PY,
+                    &PZ) != 6) {
+      throw std::runtime_error("Bad case1 specification");
+    }
+    std::vector<std::pair<std::string, std::string>> table;
+    while (std::getline(in, line) && !line.empty()) {
+      table.emplace_back(line.substr(0, 1), line.substr(3));
+    }
+    Flat3D<char> chars(Z, Y, X);
+    for (int z = 0; z < Z; ++z) {
+      for (int y = 0; y < Y; ++y) {
+        std::getline(in, line);
+        for (int x = 0; x < X; ++x) {
+          chars.at(z, y, x) = line[x];
+        }
+      }
+      std::getline(in, line);
+    }
+
+    std::vector<Block> blocks;
+    std::ostringstream output;
+    BlockModel bm;
+    bm.set_specification(X, Y, Z, PX, PY, PZ);
+    bm.set_tag_table(table);
+    bm.set_block_sink([&](const Block& b, const std::string& label) {
+      blocks.push_back(b);
+      b.print_block(output, label);
+    });
+    bm.compress(chars);
+    if (output.str() != expected) {
+      throw std::runtime_error("compress(Flat3D<char>) differs from read_model()");
+    }
+
+    // Same model as tag indices
+    Flat3D<WideCell> indices(Z, Y, X);
+    for (std::size_t i = 0; i < chars.data.size(); ++i) {
+      int index = bm.tag_index(std::string(1, chars.data[i]));
+      if (index < 0) {
+        throw std::runtime_error("case1 cell missing from its tag table");
+      }
+      indices.data[i] = static_cast<WideCell>(index);
+    }
+    std::vector<Block> index_blocks;
+    bm.set_block_sink([&](const Block& b, const std::string& label) {
+      index_blocks.push_back(b);
+      if (label != bm.tag_label(b.tag)) {
+        throw std::runtime_error("Sink label does not match tag_label()");
+      }
+    });
+    bm.compress(indices);
+    if (index_blocks.size() != blocks.size()) {
+      throw std::runtime_error("compress(Flat3D<WideCell>) block count differs");
+    }
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+      const Block& a = blocks[i];
+      const Block& b = index_blocks[i];
+      if (a.x != b.x || a.y != b.y || a.z != b.z || a.width != b.width ||
+          a.height != b.height || a.depth != b.depth || a.tag != b.tag) {
+        throw std::runtime_error("compress(Flat3D<WideCell>) blocks differ");
+      }
+    }
+
+    // Shape mismatches and out-of-range indices are rejected
+    bool threw = false;
+    try {
+      bm.compress(Flat3D<char>(Z, Y, X + 1));
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    indices.data[0] = static_cast<WideCell>(table.size() + 1);
+    try {
+      bm.compress(indices);
+      threw = false;
+    } catch (const std::runtime_error&) {
+    }
+    if (!threw) {
+      throw std::runtime_error("Invalid in-memory model was accepted");
+    }
+
+    std::cout << "✓ In-memory compression test passed - " << blocks.size()
+              << " blocks\n";
+  }
 };
 
 int main() {
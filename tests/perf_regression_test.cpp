@@ -0,0 +1,200 @@
+#include "block_model.h"
+#include "test_models.h"
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Guards BlockGrowth against performance regressions by asserting on operation
+// counts, which are deterministic, instead of wall time. Each synthetic model
+// has a budget pinned to the counts measured when it was added: a change that
+// makes the algorithm do more work fails here. If a change legitimately lowers
+// a count, tighten the budget to the new value.
+class PerfRegressionTest {
+public:
+  static void run_all_tests() {
+    std::cout << "Running perf regression tests...\n";
+
+    if (!growth_counters_enabled()) {
+      throw std::runtime_error(
+          "BlockGrowth was built without -DBLOCK_GROWTH_COUNTERS");
+    }
+
+    test_uniform_model();
+    test_layered_model();
+    test_noisy_model();
+    test_ragged_edges_model();
+    test_wide_tag_model();
+    test_sparse_tags_in_large_table();
+    test_counts_independent_of_threads();
+
+    std::cout << "All perf regression tests passed!\n";
+  }
+
+private:
+  struct Budget {
+    std::uint64_t blocks_emitted; // exact: a change here changes the output
+    std::uint64_t window_checks;
+    std::uint64_t grow_block_calls;
+    std::uint64_t cells_scanned;
+  };
+
+  static GrowthCounters compress(const std::string& model,
+                                 unsigned int threads = 0) {
+    std::istringstream in(model);
+    std::uint64_t lines = 0;
+
+    BlockModel bm(in);
+    if (threads > 0) {
+      bm.set_num_threads(threads);
+    }
+    bm.set_block_sink([&](const Block&, const std::string&) { ++lines; });
+    bm.read_specification();
+    bm.read_tag_table();
+    bm.read_model();
+    GrowthCounters counters = bm.get_growth_counters();
+
+    // The counters must agree with what was actually emitted
+    if (lines != counters.blocks_emitted) {
+      throw std::runtime_error("blocks_emitted does not match emitted blocks");
+    }
+    return counters;
+  }
+
+  static void check_budget(const std::string& name, const std::string& model,
+                           const Budget& budget) {
+    GrowthCounters c = compress(model);
+
+    std::cout << "  " << name << ": " << c.blocks_emitted << " blocks, "
+              << c.window_checks << " window checks, " << c.grow_block_calls
+              << " grow_block calls, " << c.cells_scanned
+              << " cells scanned ("
+              << c.cells_scanned / std::max<std::uint64_t>(c.blocks_emitted, 1)
+              << " per block)\n";
+
+    if (c.blocks_emitted != budget.blocks_emitted) {
+      throw std::runtime_error(name + ": block count changed");
+    }
+    if (c.window_checks > budget.window_checks) {
+      throw std::runtime_error(name + ": window checks over budget");
+    }
+    if (c.grow_block_calls > budget.grow_block_calls) {
+      throw std::runtime_error(name + ": grow_block calls over budget");
+    }
+    if (c.cells_scanned > budget.cells_scanned) {
+      throw std::runtime_error(name + ": cells scanned over budget");
+    }
+    if (c.window_checks < budget.window_checks ||
+        c.grow_block_calls < budget.grow_block_calls ||
+        c.cells_scanned < budget.cells_scanned) {
+      std::cout << "  " << name
+                << ": below budget, tighten it in perf_regression_test.cpp\n";
+    }
+
+    std::cout << "✓ " << name << " within budget\n";
+  }
+
+  // Tiny deterministic generator so the models never depend on the platform
+  static std::uint32_t lcg(std::uint32_t seed) {
+    return seed * 1664525u + 1013904223u;
+  }
+
+  static void test_uniform_model() {
+    std::string model = TestModels::make_model(
+        32, 32, 16, 8, 8, 8, "a, A\n", [](int, int, int) { return "a"; });
+    check_budget("uniform", model, {32, 64, 32, 65568});
+  }
+
+  static void test_layered_model() {
+    std::string model = TestModels::make_model(
+        30, 20, 12, 10, 10, 4, "a, A\nb, B\nc, C\n", [](int x, int, int z) {
+          if (x % 10 < 3) {
+            return "c";
+          }
+          return (z / 3) % 2 == 0 ? "a" : "b";
+        });
+    check_budget("layered", model, {54, 12006, 309636, 3121116});
+  }
+
+  static void test_noisy_model() {
+    std::string model = TestModels::make_model(
+        24, 24, 8, 6, 6, 4, "a, A\nb, B\nc, C\n", [](int x, int y, int z) {
+          // Blobs of 3x3x2 cells with a pseudo-random tag each
+          std::uint32_t h = lcg(lcg(lcg(x / 3 + 1) ^ (y / 3 + 17)) ^ (z / 2 + 131));
+          return std::string(1, static_cast<char>('a' + (h >> 16) % 3));
+        });
+    check_budget("noisy", model, {191, 15035, 2320, 100473});
+  }
+
+  static void test_ragged_edges_model() {
+    // Dimensions that do not divide by the parent size leave partial parents
+    std::string model = TestModels::make_model(
+        23, 17, 11, 8, 8, 4, "a, A\nb, B\n", [](int x, int y, int z) {
+          return (x + 2 * y + 3 * z) % 7 < 4 ? "a" : "b";
+        });
+    check_budget("ragged edges", model, {2538, 889810, 6411, 2350621});
+  }
+
+  static void test_wide_tag_model() {
+    // The compression test's 300-tag fixture, on the two-byte cell path
+    check_budget("wide tags", TestModels::wide_tag_model(),
+                 {612, 30744, 3192, 89638});
+  }
+
+  static void test_sparse_tags_in_large_table() {
+    // The model uses 40 codes; listing 20000 in the table must not add work
+    auto cell = [](int x, int y, int z) {
+      int code = ((x / 2) * 7 + (y / 3) * 3 + z) % 40 * 500;
+      return TestModels::padded_tag(code, 5);
+    };
+    auto model = [&](int step) {
+      return TestModels::make_model(
+          32, 24, 6, 8, 6, 3, TestModels::numbered_tag_table(20000, 5, step),
+          cell);
+    };
+
+    GrowthCounters small = compress(model(500));
+    GrowthCounters large = compress(model(1));
+    if (small.blocks_emitted != large.blocks_emitted ||
+        small.cells_scanned != large.cells_scanned ||
+        small.mode_slots_scanned != large.mode_slots_scanned) {
+      throw std::runtime_error("Operation counts grow with unused table tags");
+    }
+
+    std::cout << "  sparse tags: " << large.mode_slots_scanned
+              << " mode slots scanned with a 20000-tag table\n";
+    std::cout << "✓ Mode histogram independent of table size\n";
+  }
+
+  static void test_counts_independent_of_threads() {
+    std::string model = TestModels::make_model(
+        24, 24, 8, 6, 6, 4, "a, A\nb, B\n", [](int x, int y, int z) {
+          return (x * y + z) % 5 < 2 ? "a" : "b";
+        });
+
+    GrowthCounters one = compress(model, 1);
+    GrowthCounters many = compress(model, 4);
+    if (one.blocks_emitted != many.blocks_emitted ||
+        one.window_checks != many.window_checks ||
+        one.grow_block_calls != many.grow_block_calls ||
+        one.cells_scanned != many.cells_scanned ||
+        one.mode_slots_scanned != many.mode_slots_scanned) {
+      throw std::runtime_error("Operation counts depend on thread count");
+    }
+
+    std::cout << "✓ Counts identical with 1 and 4 threads\n";
+  }
+};
+
+int main() {
+  std::cout << "=== Perf Regression Test Suite ===\n";
+
+  try {
+    PerfRegressionTest::run_all_tests();
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "Test suite failed with exception: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef TEST_MODELS_H
+#define TEST_MODELS_H
+
+#include <functional>
+#include <sstream>
+#include <string>
+
+// Synthetic models shared by compression_test.cpp and perf_regression_test.cpp
+class TestModels {
+public:
+  using CellFn = std::function<std::string(int x, int y, int z)>;
+
+  // Writes a model in the stdin format; cell(x, y, z) returns the tag text
+  static std::string make_model(int x_count, int y_count, int z_count,
+                                int parent_x, int parent_y, int parent_z,
+                                const std::string& tag_table,
+                                const CellFn& cell) {
+    std::ostringstream out;
+    out << x_count << "," << y_count << "," << z_count << "," << parent_x
+        << "," << parent_y << "," << parent_z << "\n";
+    out << tag_table << "\n";
+    for (int z = 0; z < z_count; ++z) {
+      for (int y = 0; y < y_count; ++y) {
+        for (int x = 0; x < x_count; ++x) {
+          out << cell(x, y, z);
+        }
+        out << "\n";
+      }
+      out << "\n";
+    }
+    return out.str();
+  }
+
+  // 'code' zero-padded to 'width' digits, e.g. padded_tag(7, 3) == "007"
+  static std::string padded_tag(int code, int width) {
+    std::string t = std::to_string(code);
+    return std::string(width - t.size(), '0') + t;
+  }
+
+  // "tag, L<code>" lines for codes 0, step, 2 * step, ... below 'end'
+  static std::string numbered_tag_table(int end, int width, int step = 1) {
+    std::ostringstream out;
+    for (int code = 0; code < end; code += step) {
+      out << padded_tag(code, width) << ", L" << code << "\n";
+    }
+    return out.str();
+  }
+
+  // 300 three-char tags, too many for one-byte cells, in 40x20x3 cells
+  static constexpr int WIDE_X = 40, WIDE_Y = 20, WIDE_Z = 3, WIDE_TAGS = 300;
+
+  static int wide_tag_code(int x, int y, int z) {
+    return (x / 3 + (y / 2) * 7 + z * 11) % WIDE_TAGS;
+  }
+
+  static std::string wide_tag_model() {
+    return make_model(WIDE_X, WIDE_Y, WIDE_Z, 8, 5, 2,
+                      numbered_tag_table(WIDE_TAGS, 3),
+                      [](int x, int y, int z) {
+                        return padded_tag(wide_tag_code(x, y, z), 3);
+                      });
+  }
+};
+
+#endif // TEST_MODELS_H